@@ -6,16 +6,6 @@
 #include <stdlib.h>
 #include "aoi.h"
 
-// aoi 视野半径
-#define AOI_RADIUS 10.0f
-// aoi 微动距离
-#define AOI_NEAR 0.25f
-// aoi 视野半径平方 用于距离比较
-#define AOI_RADIUS2 (AOI_RADIUS * AOI_RADIUS)
-// aoi 实体微动判定 移动处于半径的一半, 则认为是微动
-#define AOI_IS_NEAR (AOI_RADIUS2 * 0.25f)
-// aoi 实体离开判定 移动处于半径的2倍, 则认为是离开
-#define AOI_IS_LEAVE (AOI_RADIUS2 * 4.0f)
 // 计算两点距离 x^2+y^2+z^2 直角三角形求斜边公式 c^2=a^2+b^2
 #define DIST2(p1,p2) ((p1[0] - p2[0]) * (p1[0] - p2[0]) + (p1[1] - p2[1]) * (p1[1] - p2[1]) + (p1[2] - p2[2]) * (p1[2] - p2[2]))
 
@@ -23,45 +13,68 @@
 #define MODE_WATCHER 1
 // 被观察者 [0000 0010]
 #define MODE_MARKER 2
-// 移动 [0000 0100]
-#define MODE_MOVE 4
-// 删除 [0000 1000]
+// 删除, 槽位空闲 [0000 1000]
 #define MODE_DROP 8
+// 移动, 每个视野环一位 [0001 0000] << ring
+#define MODE_MOVE(ring) (16 << (ring))
+#define MODE_MOVE_ALL (((1 << AOI_MAX_RING) - 1) << 4)
 
 #define INVALID_ID (~0)
+// 无效的实体表索引
+#define INVALID_INDEX (~0u)
 #define PRE_ALLOC 16
+// 场景镜像标识 'AOIS'
+#define SNAPSHOT_MAGIC 0x53494f41
+// 场景镜像格式版本, 改变 struct object, struct map_slot, struct pair 或 mode 位定义时需要 +1
+#define SNAPSHOT_VERSION 1
 
 
 // 实体
 struct object {
-    int ref; // 引用数
-    uint32_t id; // 唯一标识
-    int version; // 实体新进入场景 或 改变了状态 或 改变了位置, 则 version 加1
+    uint32_t id; // 唯一标识, 槽位空闲时存放下一个空闲槽位的索引
+    uint32_t version; // 实体新进入场景 或 改变了状态 或 改变了位置 或 槽位被回收, 则 version 加1
     int mode; // 实体状态
+    uint32_t layer; // 实体所在层掩码
+    uint32_t interest; // 作为观察者时关心的层掩码
     float last[3]; // 上一次位置坐标
     float position[3]; // 当前位置坐标
 };
 
+// 实体表, 所有实体连续存放, 用32位索引寻址
+// 槽位回收时 version 加1, 充当代数计数, 热点对里记录的旧 version 因此自动失效
+struct object_table {
+    int cap; // slot数组大小
+    int number; // 已经使用过的槽位数量
+    uint32_t freelist; // 空闲槽位单链表头
+    struct object * slot; // 实体数组
+};
+
 // 实体集合
 struct object_set {
     int cap; // slot数组大小
     int number; // 当前分配到哪个索引
-    struct object ** slot; // 实体数组
+    uint32_t * slot; // 实体索引数组
+};
+
+// 热点对, 只存实体索引和版本号
+struct pair {
+    uint32_t watcher; // 观察者索引
+    uint32_t marker; // 被观察者索引
+    uint32_t watcher_version; // 观察者 version
+    uint32_t marker_version; // 被观察者 version
 };
 
-// 热点对单链表
+// 热点对数组
 struct pair_list {
-    struct pair_list * next;
-    struct object * watcher; // 观察者
-    struct object * marker; // 被观察者
-    int watcher_version; // 观察者 version
-    int marker_version; // 被观察者 version
+    int cap; // slot数组大小
+    int number; // 热点对数量
+    struct pair * slot;
 };
 
 //
 struct map_slot {
     uint32_t id;
-    struct object * obj;
+    uint32_t index; // 实体表索引
     int next;
 };
 
@@ -72,25 +85,73 @@ struct map {
     struct map_slot * slot; // 数组头指针
 };
 
+// 视野环, 每个环有自己的半径, 处理周期和热点对
+// 第 k 个环只负责距离处于 [内环半径, 本环半径) 之间的实体对
+struct aoi_ring {
+    float radius2; // 半径平方
+    float inner2; // 内环半径平方, 最内环为 0
+    float leave2; // 离开判定, 半径的2倍的平方
+    int period; // 每隔多少次 aoi_message 处理一次
+    struct pair_list * hot; // 本环的热点对
+};
+
 struct aoi_space {
     aoi_Alloc alloc;
     void * alloc_ud;
     struct map * object;
+    struct object_table * table;
     struct object_set * watcher_static;
     struct object_set * marker_static;
     struct object_set * watcher_move;
     struct object_set * marker_move;
-    struct pair_list * hot;
+    float near2; // 微动判定, 取最内环半径的一半的平方
+    uint32_t tick; // aoi_message 调用次数
+    int ring_n;
+    struct aoi_ring ring[AOI_MAX_RING];
 };
 
-static struct object *
+static inline struct object *
+get_object(struct aoi_space * space, uint32_t index) {
+    return &space->table->slot[index];
+}
+
+// 从实体表分配一个槽位, 优先复用空闲槽位
+static uint32_t
 new_object(struct aoi_space * space, uint32_t id) {
-    struct object * obj = space->alloc(space->alloc_ud, NULL, sizeof(*obj));
-    obj->ref = 1;
+    struct object_table * t = space->table;
+    uint32_t index;
+    if (t->freelist != INVALID_INDEX) {
+        index = t->freelist;
+        t->freelist = t->slot[index].id;
+    } else {
+        if (t->number >= t->cap) {
+            int cap = t->cap * 2;
+            void * tmp = t->slot;
+            t->slot = space->alloc(space->alloc_ud, NULL, cap * sizeof(struct object));
+            memcpy(t->slot, tmp, t->cap * sizeof(struct object));
+            space->alloc(space->alloc_ud, tmp, t->cap * sizeof(struct object));
+            t->cap = cap;
+        }
+        index = t->number++;
+        t->slot[index].version = 0;
+    }
+    struct object * obj = &t->slot[index];
     obj->id = id;
-    obj->version = 0;
     obj->mode = 0;
-    return obj;
+    obj->layer = AOI_LAYER_ALL;
+    obj->interest = AOI_LAYER_ALL;
+    return index;
+}
+
+// 回收槽位
+static void
+delete_object(struct aoi_space * space, uint32_t index) {
+    struct object_table * t = space->table;
+    struct object * obj = &t->slot[index];
+    obj->mode = MODE_DROP;
+    ++obj->version;
+    obj->id = t->freelist;
+    t->freelist = index;
 }
 
 static inline struct map_slot *
@@ -107,12 +168,12 @@ static void rehash(struct aoi_space * space, struct map *m);
 // 第2次插入 id=37 执行 @3 情况
 // 第3次插入 id=15 执行 @2 情况
 static void
-map_insert(struct aoi_space * space , struct map * m, uint32_t id , struct object *obj) {
+map_insert(struct aoi_space * space , struct map * m, uint32_t id , uint32_t index) {
     struct map_slot *s = mainposition(m, id);
     // @1
     if (s->id == INVALID_ID) {
         s->id = id;
-        s->obj = obj;
+        s->index = index;
         return;
     }
     // @3
@@ -123,13 +184,13 @@ map_insert(struct aoi_space * space , struct map * m, uint32_t id , struct objec
             last = &m->slot[last->next];
         }
         uint32_t temp_id = s->id;
-        struct object * temp_obj = s->obj;
+        uint32_t temp_index = s->index;
         last->next = s->next;
         s->id = id;
-        s->obj = obj;
+        s->index = index;
         s->next = -1;
-        if (temp_obj) {
-            map_insert(space, m, temp_id, temp_obj);
+        if (temp_index != INVALID_INDEX) {
+            map_insert(space, m, temp_id, temp_index);
         }
         return;
     }
@@ -138,14 +199,14 @@ map_insert(struct aoi_space * space , struct map * m, uint32_t id , struct objec
         struct map_slot * temp = &m->slot[m->lastfree--];
         if (temp->id == INVALID_ID) {
             temp->id = id;
-            temp->obj = obj;
+            temp->index = index;
             temp->next = s->next;
             s->next = (int)(temp - m->slot);
             return;
         }
     }
     rehash(space, m);
-    map_insert(space, m, id, obj);
+    map_insert(space, m, id, index);
 }
 
 // map 扩容
@@ -160,61 +221,51 @@ rehash(struct aoi_space * space, struct map *m) {
     for (i=0; i<m->size; i++) {
         struct map_slot * s = &m->slot[i];
         s->id = INVALID_ID;
-        s->obj = NULL;
+        s->index = INVALID_INDEX;
         s->next = -1;
     }
     for (i=0; i<old_size; i++) {
         struct map_slot * s = &old_slot[i];
-        if (s->obj) {
-            map_insert(space, m, s->id, s->obj);
+        if (s->index != INVALID_INDEX) {
+            map_insert(space, m, s->id, s->index);
         }
     }
     // 释放旧内存
     space->alloc(space->alloc_ud, old_slot, old_size * sizeof(struct map_slot));
 }
 
-static struct object *
+static uint32_t
 map_query(struct aoi_space *space, struct map * m, uint32_t id) {
     struct map_slot *s = mainposition(m, id);
     for (;;) {
         if (s->id == id) {
-            if (s->obj == NULL) {
-                s->obj = new_object(space, id);
+            if (s->index == INVALID_INDEX) {
+                s->index = new_object(space, id);
             }
-            return s->obj;
+            return s->index;
         }
         if (s->next < 0) {
             break;
         }
         s=&m->slot[s->next];
     }
-    struct object * obj = new_object(space, id);
-    map_insert(space, m , id , obj);
-    return obj;
+    uint32_t index = new_object(space, id);
+    map_insert(space, m , id , index);
+    return index;
 }
 
-static void
-map_foreach(struct map * m , void (*func)(void *ud, struct object *obj), void *ud) {
-    int i;
-    for (i=0; i<m->size; i++) {
-        if (m->slot[i].obj) {
-            func(ud, m->slot[i].obj);
-        }
-    }
-}
-
-static struct object *
+static uint32_t
 map_drop(struct map *m, uint32_t id) {
     uint32_t hash = id & (m->size-1);
     struct map_slot *s = &m->slot[hash];
     for (;;) {
         if (s->id == id) {
-            struct object * obj = s->obj;
-            s->obj = NULL;
-            return obj;
+            uint32_t index = s->index;
+            s->index = INVALID_INDEX;
+            return index;
         }
         if (s->next < 0) {
-            return NULL;
+            return INVALID_INDEX;
         }
         s=&m->slot[s->next];
     }
@@ -236,33 +287,26 @@ map_new(struct aoi_space *space) {
     for (i=0; i<m->size; i++) {
         struct map_slot * s = &m->slot[i];
         s->id = INVALID_ID;
-        s->obj = NULL;
+        s->index = INVALID_INDEX;
         s->next = -1;
     }
     return m;
 }
 
-// 添加实体引用数
-inline static void
-grab_object(struct object *obj) {
-    ++obj->ref;
+static struct object_table *
+table_new(struct aoi_space * space) {
+    struct object_table * t = space->alloc(space->alloc_ud, NULL, sizeof(*t));
+    t->cap = PRE_ALLOC;
+    t->number = 0;
+    t->freelist = INVALID_INDEX;
+    t->slot = space->alloc(space->alloc_ud, NULL, t->cap * sizeof(struct object));
+    return t;
 }
 
-// 释放实体
 static void
-delete_object(void *s, struct object * obj) {
-    struct aoi_space * space = s;
-    space->alloc(space->alloc_ud, obj, sizeof(*obj));
-}
-
-// 减少实体引用数
-inline static void
-drop_object(struct aoi_space * space, struct object *obj) {
-    --obj->ref;
-    if (obj->ref <=0) {
-        map_drop(space->object, obj->id);
-        delete_object(space, obj);
-    }
+table_delete(struct aoi_space * space, struct object_table * t) {
+    space->alloc(space->alloc_ud, t->slot, t->cap * sizeof(struct object));
+    space->alloc(space->alloc_ud, t, sizeof(*t));
 }
 
 static struct object_set *
@@ -270,10 +314,19 @@ set_new(struct aoi_space * space) {
     struct object_set * set = space->alloc(space->alloc_ud, NULL, sizeof(*set));
     set->cap = PRE_ALLOC;
     set->number = 0;
-    set->slot = space->alloc(space->alloc_ud, NULL, set->cap * sizeof(struct object *));
+    set->slot = space->alloc(space->alloc_ud, NULL, set->cap * sizeof(uint32_t));
     return set;
 }
 
+static struct pair_list *
+pair_list_new(struct aoi_space * space) {
+    struct pair_list * list = space->alloc(space->alloc_ud, NULL, sizeof(*list));
+    list->cap = PRE_ALLOC;
+    list->number = 0;
+    list->slot = space->alloc(space->alloc_ud, NULL, list->cap * sizeof(struct pair));
+    return list;
+}
+
 // 创建一个场景
 struct aoi_space *
 aoi_create(aoi_Alloc alloc, void *ud) {
@@ -281,37 +334,48 @@ aoi_create(aoi_Alloc alloc, void *ud) {
     space->alloc = alloc;
     space->alloc_ud = ud;
     space->object = map_new(space);
+    space->table = table_new(space);
     space->watcher_static = set_new(space);
     space->marker_static = set_new(space);
     space->watcher_move = set_new(space);
     space->marker_move = set_new(space);
-    space->hot = NULL;
+    space->near2 = AOI_IS_NEAR;
+    space->tick = 0;
+    space->ring_n = 1;
+    int i;
+    for (i=0; i<AOI_MAX_RING; i++) {
+        struct aoi_ring * r = &space->ring[i];
+        r->radius2 = AOI_RADIUS2;
+        r->inner2 = 0;
+        r->leave2 = AOI_IS_LEAVE;
+        r->period = 1;
+        r->hot = pair_list_new(space);
+    }
     return space;
 }
 
 static void
-delete_pair_list(struct aoi_space * space) {
-    struct pair_list * p = space->hot;
-    while (p) {
-        struct pair_list * next = p->next;
-        space->alloc(space->alloc_ud, p, sizeof(*p));
-        p = next;
-    }
+delete_pair_list(struct aoi_space * space, struct pair_list * list) {
+    space->alloc(space->alloc_ud, list->slot, list->cap * sizeof(struct pair));
+    space->alloc(space->alloc_ud, list, sizeof(*list));
 }
 
 static void
 delete_set(struct aoi_space *space, struct object_set * set) {
     if (set->slot) {
-        space->alloc(space->alloc_ud, set->slot, sizeof(struct object *) * set->cap);
+        space->alloc(space->alloc_ud, set->slot, sizeof(uint32_t) * set->cap);
     }
     space->alloc(space->alloc_ud, set, sizeof(*set));
 }
 
 void
 aoi_release(struct aoi_space *space) {
-    map_foreach(space->object, delete_object, space);
+    int i;
     map_delete(space, space->object);
-    delete_pair_list(space);
+    table_delete(space, space->table);
+    for (i=0; i<AOI_MAX_RING; i++) {
+        delete_pair_list(space, space->ring[i].hot);
+    }
     delete_set(space,space->watcher_static);
     delete_set(space,space->marker_static);
     delete_set(space,space->watcher_move);
@@ -365,8 +429,8 @@ change_mode(struct object * obj, bool set_watcher, bool set_marker) {
 
 // 两个坐标点是否处于附近
 inline static bool
-is_near(float p1[3], float p2[3]) {
-    return DIST2(p1,p2) < AOI_IS_NEAR;
+is_near(struct aoi_space * space, float p1[3], float p2[3]) {
+    return DIST2(p1,p2) < space->near2;
 }
 
 // 两点之间距离
@@ -376,10 +440,10 @@ dist2(struct object *p1, struct object *p2) {
     return d;
 }
 
-// 更新实体的状态和位置
-void
-aoi_update(struct aoi_space * space , uint32_t id, const char * modestring , float pos[3]) {
-    struct object * obj = map_query(space, space->object, id);
+// 更新实体的状态和位置, mask_changed 表示层掩码已改变, 需要重新生成热点对
+static void
+update_object(struct aoi_space * space , uint32_t index, const char * modestring , float pos[3], bool mask_changed) {
+    struct object * obj = get_object(space, index);
     int i;
     bool set_watcher = false;
     bool set_marker = false;
@@ -394,155 +458,493 @@ aoi_update(struct aoi_space * space , uint32_t id, const char * modestring , flo
             set_marker = true;
             break;
         case 'd':
-            if (!(obj->mode & MODE_DROP)) {
-                obj->mode = MODE_DROP;
-                drop_object(space, obj);
-            }
+            map_drop(space->object, obj->id);
+            delete_object(space, index);
             return;
         }
     }
 
-    if (obj->mode & MODE_DROP) {
-        obj->mode &= ~MODE_DROP;
-        grab_object(obj);
-    }
-
-    bool changed = change_mode(obj, set_watcher, set_marker);
+    bool changed = change_mode(obj, set_watcher, set_marker) || mask_changed;
 
     copy_position(obj->position, pos);
-    if (changed || !is_near(pos, obj->last)) {
+    if (changed || !is_near(space, pos, obj->last)) {
         // new object or change object mode
         // or position changed
         copy_position(obj->last , pos);
-        obj->mode |= MODE_MOVE;
+        obj->mode |= MODE_MOVE_ALL;
         ++obj->version;
     }
 }
 
-static void
-drop_pair(struct aoi_space * space, struct pair_list *p) {
-    drop_object(space, p->watcher);
-    drop_object(space, p->marker);
-    space->alloc(space->alloc_ud, p, sizeof(*p));
+void
+aoi_update(struct aoi_space * space , uint32_t id, const char * modestring , float pos[3]) {
+    uint32_t index = map_query(space, space->object, id);
+    update_object(space, index, modestring, pos, false);
 }
 
+// 更新实体的状态, 位置和层掩码
+void
+aoi_update_mask(struct aoi_space * space , uint32_t id, const char * modestring , float pos[3], uint32_t layer, uint32_t interest) {
+    uint32_t index = map_query(space, space->object, id);
+    struct object * obj = get_object(space, index);
+    bool mask_changed = obj->layer != layer || obj->interest != interest;
+    obj->layer = layer;
+    obj->interest = interest;
+    update_object(space, index, modestring, pos, mask_changed);
+}
+
+// 线性扫描热点对数组, 保留的热点对原地前移
 static void
-flush_pair(struct aoi_space * space, aoi_Callback cb, void *ud) {
-    struct pair_list **last = &(space->hot);
-    struct pair_list *p = *last;
-    while (p) {
-        struct pair_list *next = p->next;
-        // 如果 观察者 或 被观察者 的状态改变了
-        if (p->watcher->version != p->watcher_version ||
-            p->marker->version != p->marker_version ||
-            (p->watcher->mode & MODE_DROP) ||
-            (p->marker->mode & MODE_DROP)
-            ) {
-            drop_pair(space, p);
-            *last = next;
-        } else {
-            float distance2 = dist2(p->watcher , p->marker);
-            if (distance2 > AOI_IS_LEAVE) {
-                drop_pair(space, p);
-                *last = next;
-            } else if (distance2 < AOI_RADIUS2) {
-                cb(ud, p->watcher->id, p->marker->id);
-                drop_pair(space, p);
-                *last = next;
-            } else {
-                last = &(p->next);
-            }
+flush_pair(struct aoi_space * space, int ring, aoi_RingCallback cb, void *ud) {
+    struct aoi_ring * r = &space->ring[ring];
+    struct pair_list * hot = r->hot;
+    int i;
+    int n = 0;
+    for (i=0; i<hot->number; i++) {
+        struct pair p = hot->slot[i];
+        struct object * watcher = get_object(space, p.watcher);
+        struct object * marker = get_object(space, p.marker);
+        // 如果 观察者 或 被观察者 的状态改变了, 或已被删除(槽位回收时 version 也会改变)
+        if (watcher->version != p.watcher_version ||
+            marker->version != p.marker_version) {
+            continue;
+        }
+        float distance2 = dist2(watcher, marker);
+        if (distance2 > r->leave2) {
+            continue;
+        }
+        if (distance2 < r->inner2) {
+            // 已进入内环, 由内环处理
+            continue;
+        }
+        if (distance2 < r->radius2) {
+            cb(ud, watcher->id, marker->id, ring);
+            continue;
         }
-        p=next;
+        hot->slot[n++] = p;
     }
+    hot->number = n;
 }
 
 static void
-set_push_back(struct aoi_space * space, struct object_set * set, struct object *obj) {
+set_push_back(struct aoi_space * space, struct object_set * set, uint32_t index) {
     if (set->number >= set->cap) {
         int cap = set->cap * 2;
         void * tmp =  set->slot;
-        set->slot = space->alloc(space->alloc_ud, NULL, cap * sizeof(struct object *));
-        memcpy(set->slot, tmp ,  set->cap * sizeof(struct object *));
-        space->alloc(space->alloc_ud, tmp, set->cap * sizeof(struct object *));
+        set->slot = space->alloc(space->alloc_ud, NULL, cap * sizeof(uint32_t));
+        memcpy(set->slot, tmp ,  set->cap * sizeof(uint32_t));
+        space->alloc(space->alloc_ud, tmp, set->cap * sizeof(uint32_t));
         set->cap = cap;
     }
-    set->slot[set->number] = obj;
+    set->slot[set->number] = index;
     ++set->number;
 }
 
 static void
-set_push(void * s, struct object * obj) {
-    struct aoi_space * space = s;
+pair_push_back(struct aoi_space * space, struct pair_list * list, struct pair * p) {
+    if (list->number >= list->cap) {
+        int cap = list->cap * 2;
+        void * tmp = list->slot;
+        list->slot = space->alloc(space->alloc_ud, NULL, cap * sizeof(struct pair));
+        memcpy(list->slot, tmp, list->cap * sizeof(struct pair));
+        space->alloc(space->alloc_ud, tmp, list->cap * sizeof(struct pair));
+        list->cap = cap;
+    }
+    list->slot[list->number] = *p;
+    ++list->number;
+}
+
+static void
+set_push(struct aoi_space * space, uint32_t index, int ring) {
+    struct object * obj = get_object(space, index);
     int mode = obj->mode;
     if (mode & MODE_WATCHER) {
-        if (mode & MODE_MOVE) {
-            set_push_back(space, space->watcher_move , obj);
-            obj->mode &= ~MODE_MOVE;
+        if (mode & MODE_MOVE(ring)) {
+            set_push_back(space, space->watcher_move , index);
+            obj->mode &= ~MODE_MOVE(ring);
         } else {
-            set_push_back(space, space->watcher_static , obj);
+            set_push_back(space, space->watcher_static , index);
         }
     }
     if (mode & MODE_MARKER) {
-        if (mode & MODE_MOVE) {
-            set_push_back(space, space->marker_move , obj);
-            obj->mode &= ~MODE_MOVE;
+        if (mode & MODE_MOVE(ring)) {
+            set_push_back(space, space->marker_move , index);
+            obj->mode &= ~MODE_MOVE(ring);
         } else {
-            set_push_back(space, space->marker_static , obj);
+            set_push_back(space, space->marker_static , index);
         }
     }
 }
 
 static void
-gen_pair(struct aoi_space * space, struct object * watcher, struct object * marker, aoi_Callback cb, void *ud) {
-    if (watcher == marker) {
+gen_pair(struct aoi_space * space, int ring, uint32_t watcher_index, uint32_t marker_index, aoi_RingCallback cb, void *ud) {
+    if (watcher_index == marker_index) {
         return;
     }
+    struct object * watcher = get_object(space, watcher_index);
+    struct object * marker = get_object(space, marker_index);
+    struct aoi_ring * r = &space->ring[ring];
     float distance2 = dist2(watcher, marker);
-    if (distance2 < AOI_RADIUS2) {
-        cb(ud, watcher->id, marker->id);
+    if (distance2 < r->inner2) {
+        // 由内环处理
         return;
     }
-    if (distance2 > AOI_IS_LEAVE) {
+    if (distance2 < r->radius2) {
+        cb(ud, watcher->id, marker->id, ring);
         return;
     }
-    struct pair_list * p = space->alloc(space->alloc_ud, NULL, sizeof(*p));
-    p->watcher = watcher;
-    grab_object(watcher);
-    p->marker = marker;
-    grab_object(marker);
-    p->watcher_version = watcher->version;
-    p->marker_version = marker->version;
-    p->next = space->hot;
-    space->hot = p;
+    if (distance2 > r->leave2) {
+        return;
+    }
+    struct pair p;
+    p.watcher = watcher_index;
+    p.marker = marker_index;
+    p.watcher_version = watcher->version;
+    p.marker_version = marker->version;
+    pair_push_back(space, r->hot, &p);
 }
 
 static void
-gen_pair_list(struct aoi_space *space, struct object_set * watcher, struct object_set * marker, aoi_Callback cb, void *ud) {
+gen_pair_list(struct aoi_space *space, int ring, struct object_set * watcher, struct object_set * marker, aoi_RingCallback cb, void *ud) {
     int i,j;
     for (i=0; i<watcher->number; i++) {
+        uint32_t w = watcher->slot[i];
+        uint32_t interest = get_object(space, w)->interest;
         for (j=0; j<marker->number; j++) {
-            gen_pair(space, watcher->slot[i], marker->slot[j], cb, ud);
+            uint32_t m = marker->slot[j];
+            // 粗筛: 先用层掩码剔除, 再进入距离判定
+            if (interest & get_object(space, m)->layer) {
+                gen_pair(space, ring, w, m, cb, ud);
+            }
         }
     }
 }
 
-void
-aoi_message(struct aoi_space *space, aoi_Callback cb, void *ud) {
-    flush_pair(space, cb, ud);
+// 处理一个视野环, 移动集合按该环的移动标记划分
+static void
+ring_message(struct aoi_space *space, int ring, aoi_RingCallback cb, void *ud) {
+    uint32_t i;
+    flush_pair(space, ring, cb, ud);
     space->watcher_static->number = 0;
     space->watcher_move->number = 0;
     space->marker_static->number = 0;
     space->marker_move->number = 0;
-    map_foreach(space->object, set_push , space);
-    gen_pair_list(space, space->watcher_static, space->marker_move, cb, ud);
-    gen_pair_list(space, space->watcher_move, space->marker_static, cb, ud);
-    gen_pair_list(space, space->watcher_move, space->marker_move, cb, ud);
+    for (i=0; i<(uint32_t)space->table->number; i++) {
+        if (!(get_object(space, i)->mode & MODE_DROP)) {
+            set_push(space, i, ring);
+        }
+    }
+    gen_pair_list(space, ring, space->watcher_static, space->marker_move, cb, ud);
+    gen_pair_list(space, ring, space->watcher_move, space->marker_static, cb, ud);
+    gen_pair_list(space, ring, space->watcher_move, space->marker_move, cb, ud);
+}
+
+// 外环按各自周期处理, 并错开相位, 避免所有外环落在同一次 tick 上
+void
+aoi_message_ring(struct aoi_space *space, aoi_RingCallback cb, void *ud) {
+    int i;
+    uint32_t tick = space->tick++;
+    for (i=0; i<space->ring_n; i++) {
+        if ((tick + i) % space->ring[i].period == 0) {
+            ring_message(space, i, cb, ud);
+        }
+    }
+}
+
+struct message_ud {
+    aoi_Callback * cb;
+    void * ud;
+};
+
+static void
+message_cb(void *ud, uint32_t watcher, uint32_t marker, int ring) {
+    struct message_ud * m = ud;
+    m->cb(m->ud, watcher, marker);
+}
+
+void
+aoi_message(struct aoi_space *space, aoi_Callback cb, void *ud) {
+    struct message_ud m = { cb, ud };
+    aoi_message_ring(space, message_cb, &m);
+}
+
+// 重新设置视野环, 清空所有热点对, 所有实体在各环重新生成消息
+int
+aoi_set_ring(struct aoi_space *space, int n, const float radius[], const int period[]) {
+    int i;
+    if (n <= 0 || n > AOI_MAX_RING) {
+        return -1;
+    }
+    for (i=0; i<n; i++) {
+        if (radius[i] <= 0 || period[i] <= 0 || (i > 0 && radius[i] <= radius[i-1])) {
+            return -1;
+        }
+    }
+    for (i=0; i<AOI_MAX_RING; i++) {
+        struct aoi_ring * r = &space->ring[i];
+        if (i < n) {
+            r->radius2 = radius[i] * radius[i];
+            r->inner2 = i > 0 ? radius[i-1] * radius[i-1] : 0;
+            r->leave2 = r->radius2 * 4.0f;
+            r->period = period[i];
+        }
+        r->hot->number = 0;
+    }
+    space->ring_n = n;
+    space->near2 = space->ring[0].radius2 * 0.25f;
+    for (i=0; i<space->table->number; i++) {
+        struct object * obj = get_object(space, i);
+        if (!(obj->mode & MODE_DROP)) {
+            obj->mode |= MODE_MOVE_ALL;
+        }
+    }
+    return 0;
+}
+
+// 场景镜像中的视野环
+struct snapshot_ring {
+    float radius2;
+    float inner2;
+    float leave2;
+    int32_t period;
+    uint32_t pair_n; // 热点对数量
+};
+
+// 场景镜像头, 后面依次紧跟 实体表, map 槽位, 各视野环的热点对
+// 镜像里只有索引没有指针, 可以直接整块读入或 mmap 后恢复, 字节序与生成镜像的机器一致
+struct snapshot_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size; // 镜像总字节数
+    uint32_t tick;
+    float near2;
+    int32_t ring_n;
+    uint32_t freelist;
+    uint32_t object_n; // 实体表已使用槽位数量
+    uint32_t map_size;
+    int32_t map_lastfree;
+    struct snapshot_ring ring[AOI_MAX_RING];
+};
+
+static size_t
+snapshot_size(struct aoi_space *space) {
+    size_t sz = sizeof(struct snapshot_header);
+    int i;
+    sz += space->table->number * sizeof(struct object);
+    sz += space->object->size * sizeof(struct map_slot);
+    for (i=0; i<space->ring_n; i++) {
+        sz += space->ring[i].hot->number * sizeof(struct pair);
+    }
+    return sz;
+}
+
+// 把场景序列化为一块连续内存, buffer 为 NULL 或 sz 不足时只返回所需字节数
+size_t
+aoi_snapshot(struct aoi_space *space, void *buffer, size_t sz) {
+    size_t need = snapshot_size(space);
+    int i;
+    if (buffer == NULL || sz < need) {
+        return need;
+    }
+    struct snapshot_header * h = buffer;
+    memset(h, 0, sizeof(*h));
+    h->magic = SNAPSHOT_MAGIC;
+    h->version = SNAPSHOT_VERSION;
+    h->size = (uint32_t)need;
+    h->tick = space->tick;
+    h->near2 = space->near2;
+    h->ring_n = space->ring_n;
+    h->freelist = space->table->freelist;
+    h->object_n = space->table->number;
+    h->map_size = space->object->size;
+    h->map_lastfree = space->object->lastfree;
+    for (i=0; i<space->ring_n; i++) {
+        struct aoi_ring * r = &space->ring[i];
+        h->ring[i].radius2 = r->radius2;
+        h->ring[i].inner2 = r->inner2;
+        h->ring[i].leave2 = r->leave2;
+        h->ring[i].period = r->period;
+        h->ring[i].pair_n = r->hot->number;
+    }
+    char * ptr = (char *)(h + 1);
+    memcpy(ptr, space->table->slot, h->object_n * sizeof(struct object));
+    ptr += h->object_n * sizeof(struct object);
+    memcpy(ptr, space->object->slot, h->map_size * sizeof(struct map_slot));
+    ptr += h->map_size * sizeof(struct map_slot);
+    for (i=0; i<space->ring_n; i++) {
+        memcpy(ptr, space->ring[i].hot->slot, h->ring[i].pair_n * sizeof(struct pair));
+        ptr += h->ring[i].pair_n * sizeof(struct pair);
+    }
+    return need;
+}
+
+// 校验镜像头, 并确认各段长度与镜像大小一致
+static bool
+snapshot_check(const struct snapshot_header * h, size_t sz) {
+    int i;
+    if (sz < sizeof(*h) || h->magic != SNAPSHOT_MAGIC || h->version != SNAPSHOT_VERSION || h->size != sz) {
+        return false;
+    }
+    if (h->ring_n <= 0 || h->ring_n > AOI_MAX_RING) {
+        return false;
+    }
+    if (h->map_size < PRE_ALLOC || (h->map_size & (h->map_size - 1)) != 0 ||
+        h->map_lastfree < -1 || h->map_lastfree >= (int32_t)h->map_size) {
+        return false;
+    }
+    size_t need = sizeof(*h) + (size_t)h->object_n * sizeof(struct object) + (size_t)h->map_size * sizeof(struct map_slot);
+    for (i=0; i<h->ring_n; i++) {
+        if (h->ring[i].period <= 0) {
+            return false;
+        }
+        need += (size_t)h->ring[i].pair_n * sizeof(struct pair);
+    }
+    return need == sz;
+}
+
+// 检查 map 槽位的 next 链没有环: 每个槽位最多被一个 next 指向, 且从链头出发能走遍所有槽位
+static bool
+map_check(aoi_Alloc alloc, void *ud, const struct map_slot * slot, uint32_t size) {
+    bool ok = true;
+    uint32_t i;
+    uint32_t visit = 0;
+    char * referred = alloc(ud, NULL, size);
+    memset(referred, 0, size);
+    for (i=0; i<size && ok; i++) {
+        int next = slot[i].next;
+        if (next >= 0) {
+            if (referred[next]) {
+                ok = false;
+            }
+            referred[next] = 1;
+        }
+    }
+    for (i=0; i<size && ok; i++) {
+        if (!referred[i]) {
+            int s = (int)i;
+            while (s >= 0) {
+                ++visit;
+                s = slot[s].next;
+            }
+        }
+    }
+    alloc(ud, referred, size);
+    // 没有走到的槽位都在环上
+    return ok && visit == size;
+}
+
+// 检查 map 与实体表一致: 每个 map 槽位指向一个未删除且 id 相同的实体, 每个实体最多被一个槽位指向,
+// 未删除的实体都能在 map 中找到
+static bool
+object_check(aoi_Alloc alloc, void *ud, const struct object * obj, uint32_t object_n, const struct map_slot * slot, uint32_t map_size) {
+    bool ok = true;
+    uint32_t i;
+    char * seen = alloc(ud, NULL, object_n);
+    memset(seen, 0, object_n);
+    for (i=0; i<map_size && ok; i++) {
+        uint32_t index = slot[i].index;
+        if (index == INVALID_INDEX) {
+            continue;
+        }
+        if (index >= object_n || seen[index] || (obj[index].mode & MODE_DROP) || obj[index].id != slot[i].id) {
+            ok = false;
+        } else {
+            seen[index] = 1;
+        }
+    }
+    for (i=0; i<object_n && ok; i++) {
+        if (!seen[i] && !(obj[i].mode & MODE_DROP)) {
+            ok = false;
+        }
+    }
+    alloc(ud, seen, object_n);
+    return ok;
+}
+
+// 从镜像恢复场景, 直接拷贝实体表, map 和热点对, 不重新生成热点对, 镜像无效返回 NULL
+struct aoi_space *
+aoi_restore(aoi_Alloc alloc, void *ud, const void *buffer, size_t sz) {
+    const struct snapshot_header * h = buffer;
+    int i;
+    uint32_t j;
+    if (!snapshot_check(h, sz)) {
+        return NULL;
+    }
+    const struct object * obj = (const struct object *)(h + 1);
+    const struct map_slot * slot = (const struct map_slot *)(obj + h->object_n);
+    const struct pair * pair = (const struct pair *)(slot + h->map_size);
+    // 索引越界的镜像视为无效
+    uint32_t free_index = h->freelist;
+    for (j=0; free_index != INVALID_INDEX; j++) {
+        // 步数超过实体数量说明空闲链表有环
+        if (free_index >= h->object_n || j >= h->object_n || obj[free_index].mode != MODE_DROP) {
+            return NULL;
+        }
+        free_index = obj[free_index].id;
+    }
+    for (j=0; j<h->map_size; j++) {
+        if (slot[j].next < -1 || slot[j].next >= (int32_t)h->map_size) {
+            return NULL;
+        }
+    }
+    if (!map_check(alloc, ud, slot, h->map_size) ||
+        !object_check(alloc, ud, obj, h->object_n, slot, h->map_size)) {
+        return NULL;
+    }
+    const struct pair * p = pair;
+    for (i=0; i<h->ring_n; i++) {
+        for (j=0; j<h->ring[i].pair_n; j++, p++) {
+            if (p->watcher >= h->object_n || p->marker >= h->object_n) {
+                return NULL;
+            }
+        }
+    }
+
+    struct aoi_space * space = aoi_create(alloc, ud);
+    space->tick = h->tick;
+    space->near2 = h->near2;
+    space->ring_n = h->ring_n;
+
+    struct object_table * t = space->table;
+    if (h->object_n > (uint32_t)t->cap) {
+        space->alloc(space->alloc_ud, t->slot, t->cap * sizeof(struct object));
+        t->cap = h->object_n;
+        t->slot = space->alloc(space->alloc_ud, NULL, t->cap * sizeof(struct object));
+    }
+    memcpy(t->slot, obj, h->object_n * sizeof(struct object));
+    t->number = h->object_n;
+    t->freelist = h->freelist;
+
+    struct map * m = space->object;
+    space->alloc(space->alloc_ud, m->slot, m->size * sizeof(struct map_slot));
+    m->size = h->map_size;
+    m->lastfree = h->map_lastfree;
+    m->slot = space->alloc(space->alloc_ud, NULL, m->size * sizeof(struct map_slot));
+    memcpy(m->slot, slot, m->size * sizeof(struct map_slot));
+
+    for (i=0; i<h->ring_n; i++) {
+        struct aoi_ring * r = &space->ring[i];
+        struct pair_list * hot = r->hot;
+        uint32_t n = h->ring[i].pair_n;
+        r->radius2 = h->ring[i].radius2;
+        r->inner2 = h->ring[i].inner2;
+        r->leave2 = h->ring[i].leave2;
+        r->period = h->ring[i].period;
+        if (n > (uint32_t)hot->cap) {
+            space->alloc(space->alloc_ud, hot->slot, hot->cap * sizeof(struct pair));
+            hot->cap = n;
+            hot->slot = space->alloc(space->alloc_ud, NULL, hot->cap * sizeof(struct pair));
+        }
+        memcpy(hot->slot, pair, n * sizeof(struct pair));
+        hot->number = n;
+        pair += n;
+    }
+    return space;
 }
 
 // 默认内存分配器
-static void *
-default_alloc(void * ud, void *ptr, size_t sz) {
+void *
+aoi_default_alloc(void * ud, void *ptr, size_t sz) {
     if (ptr == NULL) {
         void *p = malloc(sz);
         return p;
@@ -554,5 +956,5 @@ default_alloc(void * ud, void *ptr, size_t sz) {
 // 使用默认内存分配器创建场景
 struct aoi_space *
 aoi_new() {
-    return aoi_create(default_alloc, NULL);
+    return aoi_create(aoi_default_alloc, NULL);
 }
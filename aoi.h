@@ -4,17 +4,61 @@
 #include <stdint.h>
 #include <stddef.h>
 
+// aoi 视野半径
+#define AOI_RADIUS 10.0f
+// aoi 微动距离
+#define AOI_NEAR 0.25f
+// aoi 视野半径平方 用于距离比较
+#define AOI_RADIUS2 (AOI_RADIUS * AOI_RADIUS)
+// aoi 实体微动判定 移动处于半径的一半, 则认为是微动
+#define AOI_IS_NEAR (AOI_RADIUS2 * 0.25f)
+// aoi 实体离开判定 移动处于半径的2倍, 则认为是离开
+#define AOI_IS_LEAVE (AOI_RADIUS2 * 4.0f)
+
+// 最多视野环数量
+#define AOI_MAX_RING 4
+// 默认层掩码, 所有层互相可见
+#define AOI_LAYER_ALL (~0u)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 typedef void * (*aoi_Alloc)(void *ud, void * ptr, size_t sz);
 typedef void (aoi_Callback)(void *ud, uint32_t watcher, uint32_t marker);
+// ring 消息所属的视野环, 0 为最内环
+typedef void (aoi_RingCallback)(void *ud, uint32_t watcher, uint32_t marker, int ring);
 
 struct aoi_space;
 
+// 默认内存分配器, aoi_new 使用 malloc/free
+void * aoi_default_alloc(void *ud, void *ptr, size_t sz);
+
 struct aoi_space * aoi_create(aoi_Alloc alloc, void *ud);
 struct aoi_space * aoi_new();
 void aoi_release(struct aoi_space *);
 
 // w(atcher) m(arker) d(rop)
 void aoi_update(struct aoi_space * space , uint32_t id, const char * mode , float pos[3]);
+// layer 实体所在层掩码, interest 观察者关心的层掩码, watcher.interest & marker.layer 为 0 时不产生消息
+void aoi_update_mask(struct aoi_space * space , uint32_t id, const char * mode , float pos[3], uint32_t layer, uint32_t interest);
+// 每次调用产生的消息集合是确定的, 但回调顺序不作保证, 逻辑层不要依赖顺序
 void aoi_message(struct aoi_space *space, aoi_Callback cb, void *ud);
 
+// 设置 n 个同心视野环, radius 由内到外递增, period 每隔多少次 aoi_message 处理一次该环
+// 默认只有一个半径为 AOI_RADIUS, 每次都处理的视野环. 成功返回 0, 参数错误返回 -1
+int aoi_set_ring(struct aoi_space *space, int n, const float radius[], const int period[]);
+// 同 aoi_message, 消息带上所属的视野环
+void aoi_message_ring(struct aoi_space *space, aoi_RingCallback cb, void *ud);
+
+// 把场景序列化为一块可重定位的连续内存, buffer 为 NULL 或 sz 不足时只返回所需字节数
+size_t aoi_snapshot(struct aoi_space *space, void *buffer, size_t sz);
+// 从 aoi_snapshot 生成的镜像恢复场景, 不重新生成热点对. buffer 需4字节对齐
+// 会校验镜像头, 各段长度, 所有索引范围, map 链和空闲链表无环, map 与实体表一一对应, 镜像无效返回 NULL
+struct aoi_space * aoi_restore(aoi_Alloc alloc, void *ud, const void *buffer, size_t sz);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif
@@ -0,0 +1,455 @@
+#ifndef _AOI_HPP
+#define _AOI_HPP
+
+// 纯头文件的 C++ 版本, 算法与 aoi.c 相同(单视野环, 带层掩码)
+// 维度, 半径, 内存分配器和消息接收者都是模板参数, 编译器可以把距离计算和消息回调内联进热点对生成和 flush_pair 的循环里
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+namespace aoi {
+
+// 编译期半径, Radius<10> 为 10.0, Radius<25, 2> 为 12.5
+template <int Num, int Den = 1>
+struct Radius {
+    static constexpr float value = (float)Num / Den;
+};
+
+// 默认内存分配器
+struct MallocAlloc {
+    void * alloc(size_t sz) {
+        return ::malloc(sz);
+    }
+    void free(void * ptr, size_t sz) {
+        ::free(ptr);
+    }
+};
+
+namespace detail {
+
+// 只存放 POD 的动态数组, 内存由外部的分配器策略管理
+template <typename T, typename Alloc>
+struct Array {
+    int cap; // slot数组大小
+    int number; // 元素数量
+    T * slot;
+
+    void init(Alloc & a, int n) {
+        cap = n;
+        number = 0;
+        slot = (T *)a.alloc(cap * sizeof(T));
+    }
+    void release(Alloc & a) {
+        a.free(slot, cap * sizeof(T));
+    }
+    void grow(Alloc & a) {
+        int ncap = cap * 2;
+        T * tmp = (T *)a.alloc(ncap * sizeof(T));
+        memcpy(tmp, slot, cap * sizeof(T));
+        a.free(slot, cap * sizeof(T));
+        slot = tmp;
+        cap = ncap;
+    }
+    void push_back(Alloc & a, const T & v) {
+        if (number >= cap) {
+            grow(a);
+        }
+        slot[number++] = v;
+    }
+};
+
+} // namespace detail
+
+// Dim 坐标维度, R 视野半径, Sink 消息接收者 void operator()(uint32_t watcher, uint32_t marker)
+template <int Dim, typename R, typename Sink, typename Alloc = MallocAlloc>
+class Space {
+public:
+    // 视野半径平方 用于距离比较
+    static constexpr float RADIUS2 = R::value * R::value;
+    // 实体微动判定 移动处于半径的一半, 则认为是微动
+    static constexpr float IS_NEAR = RADIUS2 * 0.25f;
+    // 实体离开判定 移动处于半径的2倍, 则认为是离开
+    static constexpr float IS_LEAVE = RADIUS2 * 4.0f;
+
+    explicit Space(const Sink & sink = Sink(), const Alloc & alloc = Alloc())
+        : sink_(sink), alloc_(alloc) {
+        map_init(PRE_ALLOC);
+        table_.init(alloc_, PRE_ALLOC);
+        freelist_ = INVALID_INDEX;
+        watcher_static_.init(alloc_, PRE_ALLOC);
+        marker_static_.init(alloc_, PRE_ALLOC);
+        watcher_move_.init(alloc_, PRE_ALLOC);
+        marker_move_.init(alloc_, PRE_ALLOC);
+        hot_.init(alloc_, PRE_ALLOC);
+    }
+
+    ~Space() {
+        alloc_.free(map_slot_, map_size_ * sizeof(MapSlot));
+        table_.release(alloc_);
+        watcher_static_.release(alloc_);
+        marker_static_.release(alloc_);
+        watcher_move_.release(alloc_);
+        marker_move_.release(alloc_);
+        hot_.release(alloc_);
+    }
+
+    Space(const Space &) = delete;
+    Space & operator=(const Space &) = delete;
+
+    Sink & sink() {
+        return sink_;
+    }
+
+    // w(atcher) m(arker) d(rop)
+    void update(uint32_t id, const char * modestring, const float pos[Dim]) {
+        uint32_t index = map_query(id);
+        update_object(index, modestring, pos, false);
+    }
+
+    // layer 实体所在层掩码, interest 观察者关心的层掩码
+    void update_mask(uint32_t id, const char * modestring, const float pos[Dim], uint32_t layer, uint32_t interest) {
+        uint32_t index = map_query(id);
+        Object & obj = table_.slot[index];
+        bool mask_changed = obj.layer != layer || obj.interest != interest;
+        obj.layer = layer;
+        obj.interest = interest;
+        update_object(index, modestring, pos, mask_changed);
+    }
+
+    void message() {
+        flush_pair();
+        watcher_static_.number = 0;
+        watcher_move_.number = 0;
+        marker_static_.number = 0;
+        marker_move_.number = 0;
+        for (uint32_t i=0; i<(uint32_t)table_.number; i++) {
+            if (!(table_.slot[i].mode & MODE_DROP)) {
+                set_push(i);
+            }
+        }
+        gen_pair_list(watcher_static_, marker_move_);
+        gen_pair_list(watcher_move_, marker_static_);
+        gen_pair_list(watcher_move_, marker_move_);
+    }
+
+private:
+    enum {
+        MODE_WATCHER = 1,
+        MODE_MARKER = 2,
+        MODE_MOVE = 4,
+        MODE_DROP = 8,
+    };
+    enum { PRE_ALLOC = 16 };
+    static constexpr uint32_t INVALID_ID = ~0u;
+    static constexpr uint32_t INVALID_INDEX = ~0u;
+    static constexpr uint32_t LAYER_ALL = ~0u;
+
+    // 实体, 槽位空闲时 id 存放下一个空闲槽位的索引
+    struct Object {
+        uint32_t id;
+        uint32_t version;
+        int mode;
+        uint32_t layer;
+        uint32_t interest;
+        float last[Dim];
+        float position[Dim];
+    };
+
+    // 热点对
+    struct Pair {
+        uint32_t watcher;
+        uint32_t marker;
+        uint32_t watcher_version;
+        uint32_t marker_version;
+    };
+
+    struct MapSlot {
+        uint32_t id;
+        uint32_t index;
+        int next;
+    };
+
+    typedef detail::Array<Object, Alloc> ObjectTable;
+    typedef detail::Array<uint32_t, Alloc> ObjectSet;
+    typedef detail::Array<Pair, Alloc> PairList;
+
+    Sink sink_;
+    Alloc alloc_;
+    int map_size_;
+    int map_lastfree_;
+    MapSlot * map_slot_;
+    ObjectTable table_;
+    uint32_t freelist_;
+    ObjectSet watcher_static_;
+    ObjectSet marker_static_;
+    ObjectSet watcher_move_;
+    ObjectSet marker_move_;
+    PairList hot_;
+
+    static inline float dist2(const float * p1, const float * p2) {
+        float d = 0;
+        for (int i=0; i<Dim; i++) {
+            float delta = p1[i] - p2[i];
+            d += delta * delta;
+        }
+        return d;
+    }
+
+    static inline void copy_position(float * des, const float * src) {
+        for (int i=0; i<Dim; i++) {
+            des[i] = src[i];
+        }
+    }
+
+    uint32_t new_object(uint32_t id) {
+        uint32_t index;
+        if (freelist_ != INVALID_INDEX) {
+            index = freelist_;
+            freelist_ = table_.slot[index].id;
+        } else {
+            if (table_.number >= table_.cap) {
+                table_.grow(alloc_);
+            }
+            index = table_.number++;
+            table_.slot[index].version = 0;
+        }
+        Object & obj = table_.slot[index];
+        obj.id = id;
+        obj.mode = 0;
+        obj.layer = LAYER_ALL;
+        obj.interest = LAYER_ALL;
+        return index;
+    }
+
+    void delete_object(uint32_t index) {
+        Object & obj = table_.slot[index];
+        obj.mode = MODE_DROP;
+        ++obj.version;
+        obj.id = freelist_;
+        freelist_ = index;
+    }
+
+    void map_init(int size) {
+        map_size_ = size;
+        map_lastfree_ = size - 1;
+        map_slot_ = (MapSlot *)alloc_.alloc(size * sizeof(MapSlot));
+        for (int i=0; i<size; i++) {
+            map_slot_[i].id = INVALID_ID;
+            map_slot_[i].index = INVALID_INDEX;
+            map_slot_[i].next = -1;
+        }
+    }
+
+    MapSlot * mainposition(uint32_t id) {
+        return &map_slot_[id & (map_size_ - 1)];
+    }
+
+    // 与 aoi.c 的 map_insert 相同
+    void map_insert(uint32_t id, uint32_t index) {
+        MapSlot * s = mainposition(id);
+        if (s->id == INVALID_ID) {
+            s->id = id;
+            s->index = index;
+            return;
+        }
+        if (mainposition(s->id) != s) {
+            MapSlot * last = mainposition(s->id);
+            while (last->next != s - map_slot_) {
+                assert(last->next >= 0);
+                last = &map_slot_[last->next];
+            }
+            uint32_t temp_id = s->id;
+            uint32_t temp_index = s->index;
+            last->next = s->next;
+            s->id = id;
+            s->index = index;
+            s->next = -1;
+            if (temp_index != INVALID_INDEX) {
+                map_insert(temp_id, temp_index);
+            }
+            return;
+        }
+        while (map_lastfree_ >= 0) {
+            MapSlot * temp = &map_slot_[map_lastfree_--];
+            if (temp->id == INVALID_ID) {
+                temp->id = id;
+                temp->index = index;
+                temp->next = s->next;
+                s->next = (int)(temp - map_slot_);
+                return;
+            }
+        }
+        rehash();
+        map_insert(id, index);
+    }
+
+    void rehash() {
+        MapSlot * old_slot = map_slot_;
+        int old_size = map_size_;
+        map_init(old_size * 2);
+        for (int i=0; i<old_size; i++) {
+            if (old_slot[i].index != INVALID_INDEX) {
+                map_insert(old_slot[i].id, old_slot[i].index);
+            }
+        }
+        alloc_.free(old_slot, old_size * sizeof(MapSlot));
+    }
+
+    uint32_t map_query(uint32_t id) {
+        MapSlot * s = mainposition(id);
+        for (;;) {
+            if (s->id == id) {
+                if (s->index == INVALID_INDEX) {
+                    s->index = new_object(id);
+                }
+                return s->index;
+            }
+            if (s->next < 0) {
+                break;
+            }
+            s = &map_slot_[s->next];
+        }
+        uint32_t index = new_object(id);
+        map_insert(id, index);
+        return index;
+    }
+
+    void map_drop(uint32_t id) {
+        MapSlot * s = mainposition(id);
+        for (;;) {
+            if (s->id == id) {
+                s->index = INVALID_INDEX;
+                return;
+            }
+            if (s->next < 0) {
+                return;
+            }
+            s = &map_slot_[s->next];
+        }
+    }
+
+    static bool change_mode(Object & obj, bool set_watcher, bool set_marker) {
+        if (obj.mode == 0) {
+            if (set_watcher) {
+                obj.mode = MODE_WATCHER;
+            }
+            if (set_marker) {
+                obj.mode |= MODE_MARKER;
+            }
+            return true;
+        }
+        int mode = (obj.mode & ~(MODE_WATCHER | MODE_MARKER)) |
+            (set_watcher ? MODE_WATCHER : 0) | (set_marker ? MODE_MARKER : 0);
+        bool change = mode != obj.mode;
+        obj.mode = mode;
+        return change;
+    }
+
+    void update_object(uint32_t index, const char * modestring, const float * pos, bool mask_changed) {
+        Object & obj = table_.slot[index];
+        bool set_watcher = false;
+        bool set_marker = false;
+        for (int i=0; modestring[i]; ++i) {
+            switch(modestring[i]) {
+            case 'w':
+                set_watcher = true;
+                break;
+            case 'm':
+                set_marker = true;
+                break;
+            case 'd':
+                map_drop(obj.id);
+                delete_object(index);
+                return;
+            }
+        }
+        bool changed = change_mode(obj, set_watcher, set_marker) || mask_changed;
+        copy_position(obj.position, pos);
+        if (changed || dist2(pos, obj.last) >= IS_NEAR) {
+            copy_position(obj.last, pos);
+            obj.mode |= MODE_MOVE;
+            ++obj.version;
+        }
+    }
+
+    // Sink 在 message 期间不能调用 update, 因此实体表不会扩容, 可以把表指针提到循环外
+    void flush_pair() {
+        const Object * table = table_.slot;
+        Pair * hot = hot_.slot;
+        int number = hot_.number;
+        int n = 0;
+        for (int i=0; i<number; i++) {
+            Pair p = hot[i];
+            const Object & watcher = table[p.watcher];
+            const Object & marker = table[p.marker];
+            if (watcher.version != p.watcher_version || marker.version != p.marker_version) {
+                continue;
+            }
+            float distance2 = dist2(watcher.position, marker.position);
+            if (distance2 > IS_LEAVE) {
+                continue;
+            }
+            if (distance2 < RADIUS2) {
+                sink_(watcher.id, marker.id);
+                continue;
+            }
+            hot[n++] = p;
+        }
+        hot_.number = n;
+    }
+
+    void set_push(uint32_t index) {
+        Object & obj = table_.slot[index];
+        int mode = obj.mode;
+        if (mode & MODE_WATCHER) {
+            if (mode & MODE_MOVE) {
+                watcher_move_.push_back(alloc_, index);
+            } else {
+                watcher_static_.push_back(alloc_, index);
+            }
+        }
+        if (mode & MODE_MARKER) {
+            if (mode & MODE_MOVE) {
+                marker_move_.push_back(alloc_, index);
+            } else {
+                marker_static_.push_back(alloc_, index);
+            }
+        }
+        obj.mode &= ~MODE_MOVE;
+    }
+
+    void gen_pair_list(const ObjectSet & watcher, const ObjectSet & marker) {
+        const Object * table = table_.slot;
+        const uint32_t * mslot = marker.slot;
+        int mnumber = marker.number;
+        for (int i=0; i<watcher.number; i++) {
+            uint32_t w = watcher.slot[i];
+            const Object & wobj = table[w];
+            for (int j=0; j<mnumber; j++) {
+                uint32_t m = mslot[j];
+                const Object & mobj = table[m];
+                // 粗筛: 先用层掩码剔除, 再进入距离判定
+                if (w == m || !(wobj.interest & mobj.layer)) {
+                    continue;
+                }
+                float distance2 = dist2(wobj.position, mobj.position);
+                if (distance2 < RADIUS2) {
+                    sink_(wobj.id, mobj.id);
+                    continue;
+                }
+                if (distance2 > IS_LEAVE) {
+                    continue;
+                }
+                Pair p = { w, m, wobj.version, mobj.version };
+                hot_.push_back(alloc_, p);
+            }
+        }
+    }
+};
+
+} // namespace aoi
+
+#endif
@@ -1,4 +1,5 @@
 #include "aoi.h"
+#include "world.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -210,8 +211,334 @@ perf_aoi() {
 
 }
 
+// 记录一次 tick 的所有消息, 用于比较两个场景的消息
+struct seam_events {
+    int number;
+    int cap;
+    uint64_t * pair;
+};
+
+static void
+seam_cb(void *ud, uint32_t watcher, uint32_t marker) {
+    struct seam_events * ev = ud;
+    if (ev->number >= ev->cap) {
+        ev->cap *= 2;
+        ev->pair = realloc(ev->pair, ev->cap * sizeof(uint64_t));
+    }
+    ev->pair[ev->number++] = ((uint64_t)watcher << 32) | marker;
+}
+
+static int
+seam_cmp(const void * a, const void * b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+// 两个已排序的消息集合, 统计 a 中 b 没有的消息数量
+static int
+seam_diff(struct seam_events * a, struct seam_events * b) {
+    int i = 0, j = 0, n = 0;
+    while (i < a->number) {
+        if (j >= b->number || a->pair[i] < b->pair[j]) {
+            n++;
+            i++;
+        } else if (a->pair[i] == b->pair[j]) {
+            i++;
+            j++;
+        } else {
+            j++;
+        }
+    }
+    return n;
+}
+
+// 边界测试: 场景沿 x=512 切成两个区域, 实体集中在边界附近来回移动,
+// 同样的更新同时交给单个场景, 比较两边整个过程中的所有消息.
+// 分区世界的实体对在边界附近可能比单个场景早几次或晚几次 tick 上报, 所以不逐次比较,
+// 只检查同一次 tick 内的重复上报, 以及整个过程中多出或丢失的消息
+static void
+perf_world() {
+    int obj_num = 500; //实体数量
+    int move_num = 100; //每次移动数量
+    int round = 50; //测试次数
+    float seam = 512;
+    float band = 40; //实体分布在边界两侧的宽度
+    struct aoi_region region[2] = {
+        { {0, 0, 0}, {seam, 1024, 1} },
+        { {seam, 0, 0}, {1024, 1024, 1} },
+    };
+    struct aoi_world * world = aoi_world_new(region, 2);
+    struct aoi_space * space = aoi_new();
+    float (*pos)[3] = malloc(obj_num * sizeof(*pos));
+    struct seam_events world_ev, space_ev;
+    int i, ii, k;
+    int extra, missing, dup = 0;
+
+    world_ev.cap = space_ev.cap = obj_num * obj_num;
+    world_ev.number = space_ev.number = 0;
+    world_ev.pair = malloc(world_ev.cap * sizeof(uint64_t));
+    space_ev.pair = malloc(space_ev.cap * sizeof(uint64_t));
+    srand(1002);
+    for (i = 0; i < obj_num; ++i) {
+        pos[i][0] = seam - band + (float)(rand() % (int)(band * 2));
+        pos[i][1] = (float)(rand() % 256);
+        pos[i][2] = 0;
+        aoi_world_update(world, i, "wm", pos[i]);
+        aoi_update(space, i, "wm", pos[i]);
+    }
+    for (k = 0; k <= round; ++k) {
+        if (k > 0) {
+            for (ii = 0; ii < move_num; ++ii) {
+                i = rand() % obj_num;
+                pos[i][0] += (float)(rand() % 7 - 3);
+                pos[i][1] += (float)(rand() % 7 - 3);
+                aoi_world_update(world, i, "wm", pos[i]);
+                aoi_update(space, i, "wm", pos[i]);
+            }
+        }
+        // 本次 tick 的消息追加在末尾, 排序后检查重复
+        int start = world_ev.number;
+        for (i = 0; i < aoi_world_region_count(world); ++i) {
+            aoi_world_region_message(world, i, seam_cb, &world_ev);
+        }
+        aoi_message(space, seam_cb, &space_ev);
+        qsort(world_ev.pair + start, world_ev.number - start, sizeof(uint64_t), seam_cmp);
+        for (i = start + 1; i < world_ev.number; ++i) {
+            if (world_ev.pair[i] == world_ev.pair[i-1]) {
+                dup++;
+            }
+        }
+    }
+    qsort(world_ev.pair, world_ev.number, sizeof(uint64_t), seam_cmp);
+    qsort(space_ev.pair, space_ev.number, sizeof(uint64_t), seam_cmp);
+    extra = seam_diff(&world_ev, &space_ev);
+    missing = seam_diff(&space_ev, &world_ev);
+    ilog("边界测试 实体 %d 个, 分区世界消息 %d, 单个场景消息 %d, 重复 %d, 多出 %d, 缺少 %d\n\n",
+        obj_num, world_ev.number, space_ev.number, dup, extra, missing);
+
+    aoi_world_release(world);
+    aoi_release(space);
+    free(world_ev.pair);
+    free(space_ev.pair);
+    free(pos);
+}
+
+// 镜像测试: 运行到一半时把场景做成镜像并恢复出一份副本,
+// 之后两份场景接收同样的更新, 比较每次 tick 的消息; 最后检查损坏的镜像会被拒绝
+static void
+perf_snapshot() {
+    int obj_num = 500; //实体数量
+    int move_num = 100; //每次移动数量
+    int round = 40; //测试次数
+    float map = 256; //场景边长
+    float radius[2] = {AOI_RADIUS, AOI_RADIUS * 3};
+    int period[2] = {1, 2};
+    struct laoi_cookie cookie = {0};
+    struct aoi_space * space = aoi_create(aoi_alloc, &cookie);
+    struct aoi_space * copy = NULL;
+    float (*pos)[3] = malloc(obj_num * sizeof(*pos));
+    char * alive = malloc(obj_num);
+    struct seam_events space_ev, copy_ev;
+    void * image = NULL;
+    size_t image_sz = 0;
+    int i, ii, k;
+    int bad_tick = 0, rejected = 0;
+
+    space_ev.cap = copy_ev.cap = obj_num * obj_num;
+    space_ev.pair = malloc(space_ev.cap * sizeof(uint64_t));
+    copy_ev.pair = malloc(copy_ev.cap * sizeof(uint64_t));
+    aoi_set_ring(space, 2, radius, period);
+    srand(1003);
+    for (i = 0; i < obj_num; ++i) {
+        pos[i][0] = (float)(rand() % (int)map);
+        pos[i][1] = (float)(rand() % (int)map);
+        pos[i][2] = 0;
+        alive[i] = 1;
+        aoi_update(space, i, "wm", pos[i]);
+    }
+    for (k = 0; k <= round; ++k) {
+        if (k > 0) {
+            for (ii = 0; ii < move_num; ++ii) {
+                i = rand() % obj_num;
+                // 偶尔删除实体, 之后再加回来, 让镜像里带上空闲槽位
+                if (alive[i] && rand() % 10 == 0) {
+                    alive[i] = 0;
+                    aoi_update(space, i, "d", pos[i]);
+                    if (copy) {
+                        aoi_update(copy, i, "d", pos[i]);
+                    }
+                    continue;
+                }
+                alive[i] = 1;
+                pos[i][0] += (float)(rand() % 21 - 10);
+                pos[i][1] += (float)(rand() % 21 - 10);
+                aoi_update(space, i, "wm", pos[i]);
+                if (copy) {
+                    aoi_update(copy, i, "wm", pos[i]);
+                }
+            }
+        }
+        space_ev.number = copy_ev.number = 0;
+        aoi_message(space, seam_cb, &space_ev);
+        if (copy) {
+            aoi_message(copy, seam_cb, &copy_ev);
+            qsort(space_ev.pair, space_ev.number, sizeof(uint64_t), seam_cmp);
+            qsort(copy_ev.pair, copy_ev.number, sizeof(uint64_t), seam_cmp);
+            if (space_ev.number != copy_ev.number || seam_diff(&space_ev, &copy_ev) != 0) {
+                bad_tick++;
+            }
+        } else if (k == round / 2) {
+            image_sz = aoi_snapshot(space, NULL, 0);
+            image = malloc(image_sz);
+            aoi_snapshot(space, image, image_sz);
+            copy = aoi_restore(aoi_alloc, &cookie, image, image_sz);
+            if (copy == NULL) {
+                ilog("镜像测试 恢复失败\n\n");
+                break;
+            }
+        }
+    }
+
+    if (image) {
+        // 截断的镜像
+        if (aoi_restore(aoi_alloc, &cookie, image, image_sz - 4) == NULL) {
+            rejected++;
+        }
+        // 末尾的热点对被改写, 索引越界
+        memset((char *)image + image_sz - 16, 0xff, 16);
+        if (aoi_restore(aoi_alloc, &cookie, image, image_sz) == NULL) {
+            rejected++;
+        }
+    }
+    aoi_release(space);
+    if (copy) {
+        aoi_release(copy);
+    }
+    ilog("镜像测试 实体 %d 个, 镜像 %d 字节, 恢复后消息不同的 tick %d 次, 损坏镜像拒绝 %d/2, 未释放内存块 %d\n\n",
+        obj_num, (int)image_sz, bad_tick, rejected, cookie.count);
+
+    free(image);
+    free(space_ev.pair);
+    free(copy_ev.pair);
+    free(alive);
+    free(pos);
+}
+
+// 视野环测试中每次 tick 的统计
+struct ring_events {
+    uint32_t tick;
+    int ring_n;
+    float radius[AOI_MAX_RING];
+    int period[AOI_MAX_RING];
+    float (*pos)[3];
+    int count[AOI_MAX_RING]; // 各环消息数量
+    int band_error; // 距离不在本环范围内的消息
+    int period_error; // 不该处理的 tick 上出现的消息
+    struct seam_events inner; // 最内环的消息
+};
+
+static void
+ring_cb(void *ud, uint32_t watcher, uint32_t marker, int ring) {
+    struct ring_events * ev = ud;
+    if (ring < 0 || ring >= ev->ring_n) {
+        ev->band_error++;
+        return;
+    }
+    float * p1 = ev->pos[watcher];
+    float * p2 = ev->pos[marker];
+    float d = (p1[0] - p2[0]) * (p1[0] - p2[0]) + (p1[1] - p2[1]) * (p1[1] - p2[1]) + (p1[2] - p2[2]) * (p1[2] - p2[2]);
+    float inner = ring > 0 ? ev->radius[ring-1] * ev->radius[ring-1] : 0;
+    float outer = ev->radius[ring] * ev->radius[ring];
+    ev->count[ring]++;
+    if (d < inner || d >= outer) {
+        ev->band_error++;
+    }
+    if ((ev->tick + ring) % ev->period[ring] != 0) {
+        ev->period_error++;
+    }
+    if (ring == 0) {
+        seam_cb(&ev->inner, watcher, marker);
+    }
+}
+
+// 视野环测试: 三个环, 外环隔几次 tick 处理一次, 检查每条消息的距离落在本环范围,
+// 只在本环的 tick 上出现, 并且最内环与只有默认视野的单个场景完全一致
+static void
+perf_ring() {
+    int obj_num = 500; //实体数量
+    int move_num = 100; //每次移动数量
+    int round = 40; //测试次数
+    float map = 256; //场景边长
+    float radius[3] = {AOI_RADIUS, AOI_RADIUS * 3, AOI_RADIUS * 6};
+    int period[3] = {1, 2, 4};
+    float bad_radius[2] = {AOI_RADIUS * 2, AOI_RADIUS}; //半径没有递增
+    struct aoi_space * space = aoi_new();
+    struct aoi_space * plain = aoi_new();
+    struct ring_events ev;
+    struct seam_events plain_ev;
+    int i, ii, k;
+    int bad_tick = 0;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.ring_n = 3;
+    for (i = 0; i < ev.ring_n; ++i) {
+        ev.radius[i] = radius[i];
+        ev.period[i] = period[i];
+    }
+    ev.pos = malloc(obj_num * sizeof(*ev.pos));
+    ev.inner.cap = plain_ev.cap = obj_num * obj_num;
+    ev.inner.pair = malloc(ev.inner.cap * sizeof(uint64_t));
+    plain_ev.pair = malloc(plain_ev.cap * sizeof(uint64_t));
+    // 参数错误时不改变场景
+    if (aoi_set_ring(space, 2, bad_radius, period) == 0 ||
+        aoi_set_ring(space, AOI_MAX_RING + 1, radius, period) == 0) {
+        ilog("视野环测试 错误参数没有被拒绝\n");
+    }
+    aoi_set_ring(space, ev.ring_n, radius, period);
+    srand(1004);
+    for (i = 0; i < obj_num; ++i) {
+        ev.pos[i][0] = (float)(rand() % (int)map);
+        ev.pos[i][1] = (float)(rand() % (int)map);
+        ev.pos[i][2] = 0;
+        aoi_update(space, i, "wm", ev.pos[i]);
+        aoi_update(plain, i, "wm", ev.pos[i]);
+    }
+    for (k = 0; k <= round; ++k) {
+        if (k > 0) {
+            for (ii = 0; ii < move_num; ++ii) {
+                i = rand() % obj_num;
+                ev.pos[i][0] += (float)(rand() % 21 - 10);
+                ev.pos[i][1] += (float)(rand() % 21 - 10);
+                aoi_update(space, i, "wm", ev.pos[i]);
+                aoi_update(plain, i, "wm", ev.pos[i]);
+            }
+        }
+        ev.tick = k;
+        ev.inner.number = plain_ev.number = 0;
+        aoi_message_ring(space, ring_cb, &ev);
+        aoi_message(plain, seam_cb, &plain_ev);
+        qsort(ev.inner.pair, ev.inner.number, sizeof(uint64_t), seam_cmp);
+        qsort(plain_ev.pair, plain_ev.number, sizeof(uint64_t), seam_cmp);
+        if (ev.inner.number != plain_ev.number || seam_diff(&ev.inner, &plain_ev) != 0) {
+            bad_tick++;
+        }
+    }
+    ilog("视野环测试 实体 %d 个, 各环消息 %d/%d/%d, 距离越界 %d, 周期不符 %d, 内环与单个场景不同的 tick %d 次\n\n",
+        obj_num, ev.count[0], ev.count[1], ev.count[2], ev.band_error, ev.period_error, bad_tick);
+
+    aoi_release(space);
+    aoi_release(plain);
+    free(ev.inner.pair);
+    free(plain_ev.pair);
+    free(ev.pos);
+}
+
 int
 main(int argc, char const *argv[]) {
+	perf_world();
+	perf_snapshot();
+	perf_ring();
 	perf_aoi();
 	return 0;
 }
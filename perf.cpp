@@ -0,0 +1,166 @@
+// C 版本 aoi.c 与 C++ 模板版本 aoi.hpp 的对比测试, 场景与 perf.c 相同
+// 用法: ./perf_cpp [实体数量] [每次移动数量] [测试次数]
+#include "aoi.h"
+#include "aoi.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+struct laoi_objs {
+	float x;
+	float y;
+	float mx;
+	float my;
+};
+
+struct laoi_cb {
+    uint32_t cb_num;
+};
+
+// 与 perf.c 中 aoi_cb_message 相同, 只统计消息数量
+struct CountSink {
+    uint32_t cb_num;
+    CountSink() : cb_num(0) {}
+    void operator()(uint32_t watcher, uint32_t marker) {
+        ++cb_num;
+    }
+};
+
+typedef aoi::Space<3, aoi::Radius<10>, CountSink> CppSpace;
+// perf.c 的场景高度为 0, 二维实例省去 z 轴计算
+typedef aoi::Space<2, aoi::Radius<10>, CountSink> CppSpace2;
+
+static void
+aoi_cb_message(void *ud, uint32_t watcher, uint32_t marker) {
+    struct laoi_cb * clua = (struct laoi_cb *)ud;
+    clua->cb_num++;
+}
+
+// 获取当前系统的微秒数
+static int64_t
+igetcurmicro() {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (int64_t)tv.tv_sec*1000*1000 + tv.tv_usec;
+}
+
+// 与 perf.c 相同的随机移动, 越界时退回
+static void
+move_objs(struct laoi_objs * objs, int obj_num, int move_num, float map_x, float map_y) {
+    int ii;
+    for (ii = 0; ii < move_num; ++ii) {
+        int id = rand()%obj_num;
+        struct laoi_objs * o = &objs[id];
+        if (rand()%2 == 1) {
+            o->x += objs[ii].mx;
+            if (o->x > map_x) {
+                o->x -= objs[ii].mx;
+            }
+        } else {
+            o->x -= objs[ii].mx;
+            if (o->x < 1) {
+                o->x += objs[ii].mx;
+            }
+        }
+        if (rand()%2 == 1) {
+            o->y += objs[ii].my;
+            if (o->y > map_y) {
+                o->y -= objs[ii].my;
+            }
+        } else {
+            o->y -= objs[ii].my;
+            if (o->y < 1) {
+                o->y += objs[ii].my;
+            }
+        }
+    }
+}
+
+int
+main(int argc, char const *argv[]) {
+    int obj_num = argc > 1 ? atoi(argv[1]) : 1000; //实体数量
+    int move_num = argc > 2 ? atoi(argv[2]) : 100; //实时移动数量
+    int round = argc > 3 ? atoi(argv[3]) : 20; //测试次数
+    float map_x = 1024; //场景宽
+    float map_y = 1024; //场景长
+    float move_index = 20;
+    int i, ii;
+    if (move_num > obj_num) {
+        move_num = obj_num;
+    }
+    struct laoi_objs * objs = (struct laoi_objs *)malloc(obj_num * sizeof(*objs));
+    int * update_id = (int *)malloc(move_num * sizeof(int));
+    struct aoi_space * space = aoi_new();
+    CppSpace cpp_space;
+    CppSpace2 cpp_space2;
+    int64_t c_time = 0;
+    int64_t cpp_time = 0;
+    int64_t cpp2_time = 0;
+
+    srand(1001);
+    for (ii = 0; ii < obj_num; ++ii) {
+        objs[ii].x = (float)(rand()%(int)(map_x));
+        objs[ii].y = (float)(rand()%(int)(map_y));
+        objs[ii].mx = (float)(rand()%(int)move_index);
+        objs[ii].my = (float)(rand()%(int)move_index);
+        float pos[3] = {objs[ii].x, objs[ii].y, 0};
+        aoi_update(space, ii, "wm", pos);
+        cpp_space.update(ii, "wm", pos);
+        cpp_space2.update(ii, "wm", pos);
+    }
+    struct laoi_cb clua = {0};
+    aoi_message(space, aoi_cb_message, &clua);
+    cpp_space.message();
+    cpp_space2.message();
+    printf("实体 %d 个, 初始消息 C %u, C++ %u, C++(2D) %u\n", obj_num, clua.cb_num, cpp_space.sink().cb_num, cpp_space2.sink().cb_num);
+
+    for (i = 0; i < round; ++i) {
+        move_objs(objs, obj_num, move_num, map_x, map_y);
+        for (ii = 0; ii < move_num; ++ii) {
+            update_id[ii] = rand()%obj_num;
+        }
+
+        clua.cb_num = 0;
+        int64_t t = igetcurmicro();
+        for (ii = 0; ii < move_num; ++ii) {
+            struct laoi_objs * o = &objs[update_id[ii]];
+            float pos[3] = {o->x, o->y, 0};
+            aoi_update(space, update_id[ii], "wm", pos);
+        }
+        aoi_message(space, aoi_cb_message, &clua);
+        int64_t ct = igetcurmicro() - t;
+
+        cpp_space.sink().cb_num = 0;
+        t = igetcurmicro();
+        for (ii = 0; ii < move_num; ++ii) {
+            struct laoi_objs * o = &objs[update_id[ii]];
+            float pos[3] = {o->x, o->y, 0};
+            cpp_space.update(update_id[ii], "wm", pos);
+        }
+        cpp_space.message();
+        int64_t cppt = igetcurmicro() - t;
+
+        cpp_space2.sink().cb_num = 0;
+        t = igetcurmicro();
+        for (ii = 0; ii < move_num; ++ii) {
+            struct laoi_objs * o = &objs[update_id[ii]];
+            float pos[2] = {o->x, o->y};
+            cpp_space2.update(update_id[ii], "wm", pos);
+        }
+        cpp_space2.message();
+        int64_t cpp2t = igetcurmicro() - t;
+
+        printf("移动 %d 个实体, 消息 C %u, C++ %u, C++(2D) %u, 耗时 C %lld 微秒, C++ %lld 微秒, C++(2D) %lld 微秒\n",
+            move_num, clua.cb_num, cpp_space.sink().cb_num, cpp_space2.sink().cb_num,
+            (long long)ct, (long long)cppt, (long long)cpp2t);
+        c_time += ct;
+        cpp_time += cppt;
+        cpp2_time += cpp2t;
+    }
+    printf("总耗时 C %lld 微秒, C++ %lld 微秒, C++(2D) %lld 微秒\n", (long long)c_time, (long long)cpp_time, (long long)cpp2_time);
+
+    aoi_release(space);
+    free(update_id);
+    free(objs);
+    return 0;
+}
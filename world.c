@@ -0,0 +1,305 @@
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include "world.h"
+
+// bucket 数组初始大小
+#define WORLD_BUCKET_SIZE 16
+// 实体的 modestring 解析结果, 与 aoi.c 内部的状态位无关
+#define ENTITY_WATCHER 1
+#define ENTITY_MARKER 2
+
+// 世界中的实体, 记录它出现在哪些区域
+// 实体只在主区域(home)里是真身, 邻近区域边界 AOI_IS_LEAVE 内的区域里以影子(只作为 marker)出现
+// 主区域只在单个 aoi_space 本来就会让 version 加1 时(新实体, 状态或掩码改变, 移动超过微动距离)才重新选择,
+// 因此微动跨过边界不会换区, 也不会让边界附近已经可见的实体对重新上报
+struct entity {
+    struct entity * next;
+    uint32_t id;
+    uint32_t region; // 实体所在区域位掩码, 包括主区域和影子区域
+    int home; // 主区域索引
+    int mode; // ENTITY_WATCHER | ENTITY_MARKER
+    uint32_t layer;
+    uint32_t interest;
+    float last[3]; // 上一次选择主区域时的位置
+};
+
+struct aoi_world {
+    aoi_Alloc alloc;
+    void * alloc_ud;
+    int region_n;
+    struct aoi_region region[AOI_WORLD_MAX_REGION];
+    struct aoi_space * space[AOI_WORLD_MAX_REGION];
+    int size; // bucket数组大小
+    int number; // 实体数量
+    struct entity ** bucket;
+};
+
+static inline struct entity **
+mainposition(struct aoi_world * world, uint32_t id) {
+    return &world->bucket[id & (world->size - 1)];
+}
+
+// bucket 扩容
+static void
+rehash(struct aoi_world * world) {
+    struct entity ** old_bucket = world->bucket;
+    int old_size = world->size;
+    int i;
+    world->size = old_size * 2;
+    world->bucket = world->alloc(world->alloc_ud, NULL, world->size * sizeof(struct entity *));
+    memset(world->bucket, 0, world->size * sizeof(struct entity *));
+    for (i=0; i<old_size; i++) {
+        struct entity * e = old_bucket[i];
+        while (e) {
+            struct entity * next = e->next;
+            struct entity ** head = mainposition(world, e->id);
+            e->next = *head;
+            *head = e;
+            e = next;
+        }
+    }
+    world->alloc(world->alloc_ud, old_bucket, old_size * sizeof(struct entity *));
+}
+
+static struct entity *
+entity_find(struct aoi_world * world, uint32_t id) {
+    struct entity * e = *mainposition(world, id);
+    while (e) {
+        if (e->id == id) {
+            return e;
+        }
+        e = e->next;
+    }
+    return NULL;
+}
+
+static struct entity *
+entity_query(struct aoi_world * world, uint32_t id) {
+    struct entity * e = entity_find(world, id);
+    if (e) {
+        return e;
+    }
+    if (world->number >= world->size) {
+        rehash(world);
+    }
+    e = world->alloc(world->alloc_ud, NULL, sizeof(*e));
+    e->id = id;
+    e->region = 0;
+    e->home = -1;
+    e->mode = 0;
+    e->layer = AOI_LAYER_ALL;
+    e->interest = AOI_LAYER_ALL;
+    struct entity ** head = mainposition(world, id);
+    e->next = *head;
+    *head = e;
+    ++world->number;
+    return e;
+}
+
+static void
+entity_delete(struct aoi_world * world, uint32_t id) {
+    struct entity ** last = mainposition(world, id);
+    struct entity * e = *last;
+    while (e) {
+        if (e->id == id) {
+            *last = e->next;
+            world->alloc(world->alloc_ud, e, sizeof(*e));
+            --world->number;
+            return;
+        }
+        last = &e->next;
+        e = e->next;
+    }
+}
+
+// 点到区域包围盒的距离平方, 点在区域内时为 0
+static float
+region_dist2(const struct aoi_region * r, const float pos[3]) {
+    float d = 0;
+    int i;
+    for (i=0; i<3; i++) {
+        float delta = 0;
+        if (pos[i] < r->min[i]) {
+            delta = r->min[i] - pos[i];
+        } else if (pos[i] > r->max[i]) {
+            delta = pos[i] - r->max[i];
+        }
+        d += delta * delta;
+    }
+    return d;
+}
+
+static inline bool
+region_contain(const struct aoi_region * r, const float pos[3]) {
+    return pos[0] >= r->min[0] && pos[0] < r->max[0] &&
+        pos[1] >= r->min[1] && pos[1] < r->max[1] &&
+        pos[2] >= r->min[2] && pos[2] < r->max[2];
+}
+
+// 两点距离平方
+static inline float
+point_dist2(const float p1[3], const float p2[3]) {
+    float dx = p1[0] - p2[0];
+    float dy = p1[1] - p2[1];
+    float dz = p1[2] - p2[2];
+    return dx * dx + dy * dy + dz * dz;
+}
+
+// 实体所在的主区域, 不在任何区域内时取最近的区域
+static int
+find_home(struct aoi_world * world, const float pos[3]) {
+    int i;
+    int home = 0;
+    float min_dist = region_dist2(&world->region[0], pos);
+    for (i=0; i<world->region_n; i++) {
+        if (region_contain(&world->region[i], pos)) {
+            return i;
+        }
+        float d = region_dist2(&world->region[i], pos);
+        if (d < min_dist) {
+            min_dist = d;
+            home = i;
+        }
+    }
+    return home;
+}
+
+struct aoi_world *
+aoi_world_create(aoi_Alloc alloc, void *ud, const struct aoi_region * region, int n) {
+    if (n <= 0 || n > AOI_WORLD_MAX_REGION) {
+        return NULL;
+    }
+    struct aoi_world * world = alloc(ud, NULL, sizeof(*world));
+    int i;
+    world->alloc = alloc;
+    world->alloc_ud = ud;
+    world->region_n = n;
+    for (i=0; i<n; i++) {
+        world->region[i] = region[i];
+        world->space[i] = aoi_create(alloc, ud);
+    }
+    world->size = WORLD_BUCKET_SIZE;
+    world->number = 0;
+    world->bucket = alloc(ud, NULL, world->size * sizeof(struct entity *));
+    memset(world->bucket, 0, world->size * sizeof(struct entity *));
+    return world;
+}
+
+void
+aoi_world_release(struct aoi_world * world) {
+    int i;
+    for (i=0; i<world->size; i++) {
+        struct entity * e = world->bucket[i];
+        while (e) {
+            struct entity * next = e->next;
+            world->alloc(world->alloc_ud, e, sizeof(*e));
+            e = next;
+        }
+    }
+    world->alloc(world->alloc_ud, world->bucket, world->size * sizeof(struct entity *));
+    for (i=0; i<world->region_n; i++) {
+        aoi_release(world->space[i]);
+    }
+    world->alloc(world->alloc_ud, world, sizeof(*world));
+}
+
+static void
+world_update(struct aoi_world * world, struct entity * e, const char * modestring, float pos[3], bool mask_changed) {
+    int i,j;
+    int mode = 0;
+    for (i=0; modestring[i]; ++i) {
+        char m = modestring[i];
+        if (m == 'd') {
+            for (j=0; j<world->region_n; j++) {
+                if (e->region & (1u << j)) {
+                    aoi_update(world->space[j], e->id, "d", pos);
+                }
+            }
+            entity_delete(world, e->id);
+            return;
+        }
+        if (m == 'w') {
+            mode |= ENTITY_WATCHER;
+        } else if (m == 'm') {
+            mode |= ENTITY_MARKER;
+        }
+    }
+
+    // 微动时保留原主区域, 实体离主区域最远不超过半个视野半径, 仍在邻区影子的覆盖范围内
+    int home = e->home;
+    if (home < 0 || mode != e->mode || mask_changed || point_dist2(pos, e->last) >= AOI_IS_NEAR) {
+        home = find_home(world, pos);
+        e->mode = mode;
+        e->last[0] = pos[0];
+        e->last[1] = pos[1];
+        e->last[2] = pos[2];
+    }
+    uint32_t region = 1u << home;
+    // 只有 marker 需要影子, 观察者只在主区域观察, 同一对实体因此只会由观察者的主区域上报一次
+    if (mode & ENTITY_MARKER) {
+        for (i=0; i<world->region_n; i++) {
+            if (i != home && region_dist2(&world->region[i], pos) < AOI_IS_LEAVE) {
+                region |= 1u << i;
+            }
+        }
+    }
+    // 离开的区域
+    uint32_t leave = e->region & ~region;
+    for (i=0; i<world->region_n; i++) {
+        if (leave & (1u << i)) {
+            aoi_update(world->space[i], e->id, "d", pos);
+        }
+    }
+    for (i=0; i<world->region_n; i++) {
+        if (i == home) {
+            aoi_update_mask(world->space[i], e->id, modestring, pos, e->layer, e->interest);
+        } else if (region & (1u << i)) {
+            aoi_update_mask(world->space[i], e->id, "m", pos, e->layer, e->interest);
+        }
+    }
+    e->home = home;
+    e->region = region;
+}
+
+void
+aoi_world_update(struct aoi_world * world, uint32_t id, const char * modestring, float pos[3]) {
+    struct entity * e = entity_query(world, id);
+    world_update(world, e, modestring, pos, false);
+}
+
+void
+aoi_world_update_mask(struct aoi_world * world, uint32_t id, const char * modestring, float pos[3], uint32_t layer, uint32_t interest) {
+    struct entity * e = entity_query(world, id);
+    bool mask_changed = e->layer != layer || e->interest != interest;
+    e->layer = layer;
+    e->interest = interest;
+    world_update(world, e, modestring, pos, mask_changed);
+}
+
+int
+aoi_world_region_count(struct aoi_world * world) {
+    return world->region_n;
+}
+
+void
+aoi_world_region_message(struct aoi_world * world, int region, aoi_Callback cb, void *ud) {
+    if (region < 0 || region >= world->region_n) {
+        return;
+    }
+    aoi_message(world->space[region], cb, ud);
+}
+
+void
+aoi_world_message(struct aoi_world * world, aoi_Callback cb, void *ud) {
+    int i;
+    for (i=0; i<world->region_n; i++) {
+        aoi_message(world->space[i], cb, ud);
+    }
+}
+
+// 使用默认内存分配器创建世界
+struct aoi_world *
+aoi_world_new(const struct aoi_region * region, int n) {
+    return aoi_world_create(aoi_default_alloc, NULL, region, n);
+}
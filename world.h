@@ -0,0 +1,34 @@
+#ifndef _AOI_WORLD_H
+#define _AOI_WORLD_H
+
+#include "aoi.h"
+
+// 一个世界最多切分的区域数量
+#define AOI_WORLD_MAX_REGION 32
+
+// 区域包围盒 [min, max)
+struct aoi_region {
+    float min[3];
+    float max[3];
+};
+
+struct aoi_world;
+
+// region 区域布局, n 区域数量(1 ~ AOI_WORLD_MAX_REGION), 失败返回 NULL
+struct aoi_world * aoi_world_create(aoi_Alloc alloc, void *ud, const struct aoi_region * region, int n);
+struct aoi_world * aoi_world_new(const struct aoi_region * region, int n);
+void aoi_world_release(struct aoi_world *);
+
+// w(atcher) m(arker) d(rop), 与 aoi_update 一致
+// 只有在单个场景也会让 version 加1 时(新实体, 状态或掩码改变, 移动超过微动距离)才会重新选择主区域,
+// 微动跨过边界不换区, 边界附近已经可见的实体对不会重新上报
+void aoi_world_update(struct aoi_world * world, uint32_t id, const char * mode, float pos[3]);
+void aoi_world_update_mask(struct aoi_world * world, uint32_t id, const char * mode, float pos[3], uint32_t layer, uint32_t interest);
+
+int aoi_world_region_count(struct aoi_world * world);
+// 只处理一个区域, 不同区域可以在不同线程同时调用(alloc 需线程安全), 但不能与 aoi_world_update 并发
+void aoi_world_region_message(struct aoi_world * world, int region, aoi_Callback cb, void *ud);
+// 依次处理所有区域
+void aoi_world_message(struct aoi_world * world, aoi_Callback cb, void *ud);
+
+#endif